@@ -0,0 +1,297 @@
+#!/usr/bin/python3
+
+# Level-of-detail pyramid of per-bucket min/max/mean, written alongside a
+# capture so long runs can be plotted without reading every sample.
+#
+# Level 0 buckets hold 2**base_shift samples, and each level above merges
+# pairs of buckets from the level below. Each level is an append-only file
+# of fixed-size records in <capture>.lod/level_<k>.dat, so the pyramid is
+# built as the samples arrive and can be queried while the capture runs (the
+# writer flushes the levels to disk every flush_interval seconds).
+#
+#   pico_lod.py <lod dir> <t_start> <t_end> [n_points]
+#
+# plots the min/max envelope and mean of [t_start, t_end].
+
+import os
+import struct
+import sys
+import time
+
+LOD_MAGIC = b'PICOLOD\0'
+LEVEL_HEADER = struct.Struct('<8sII')
+# t_first, t_last, min, max, mean, count
+BUCKET = struct.Struct('<QQfffI')
+
+
+def level_file_name(lod_dir, level):
+        return os.path.join(lod_dir, f"level_{level:02d}.dat")
+
+
+def merge_buckets(a, b):
+        count = a[5] + b[5]
+        return (a[0], b[1], min(a[2], b[2]), max(a[3], b[3]),
+                (a[4] * a[5] + b[4] * b[5]) / count, count)
+
+
+class _Bucket:
+
+        def __init__(self, t, value):
+                self.t_first = t
+                self.t_last = t
+                self.min = value
+                self.max = value
+                self.sum = value
+                self.count = 1
+
+        def add(self, t, value):
+                self.t_last = t
+                self.min = min(self.min, value)
+                self.max = max(self.max, value)
+                self.sum += value
+                self.count += 1
+
+        def merge(self, other):
+                self.t_last = other.t_last
+                self.min = min(self.min, other.min)
+                self.max = max(self.max, other.max)
+                self.sum += other.sum
+                self.count += other.count
+                return self
+
+        def pack(self):
+                return BUCKET.pack(self.t_first, self.t_last, self.min, self.max,
+                                   self.sum / self.count, self.count)
+
+
+class LodPyramidWriter:
+
+        def __init__(self, lod_dir, base_shift=4, flush_interval=1.0):
+                self.lod_dir = lod_dir
+                self.base_shift = base_shift
+                self.base_size = 1 << base_shift
+                self.flush_interval = flush_interval
+                self.last_flush = time.monotonic()
+
+                # levels left by an earlier (longer) capture would otherwise be
+                # read as part of this one
+                os.makedirs(lod_dir, exist_ok=True)
+                for name in os.listdir(lod_dir):
+                        if name.startswith('level_') and name.endswith('.dat'):
+                                os.remove(os.path.join(lod_dir, name))
+
+                self.files = []
+                self.n_written = []
+                # first half of a pair waiting for its partner, per level
+                self.pending = []
+                self.current = None
+
+        def _level(self, level):
+                while len(self.files) <= level:
+                        k = len(self.files)
+                        f = open(level_file_name(self.lod_dir, k), 'wb')
+                        f.write(LEVEL_HEADER.pack(LOD_MAGIC, k, self.base_shift))
+                        self.files.append(f)
+                        self.n_written.append(0)
+                        self.pending.append(None)
+                return self.files[level]
+
+        def _write(self, level, bucket):
+                self._level(level).write(bucket.pack())
+                self.n_written[level] += 1
+
+        def _emit(self, level, bucket):
+                self._write(level, bucket)
+                if self.pending[level] is None:
+                        self.pending[level] = bucket
+                else:
+                        merged = self.pending[level].merge(bucket)
+                        self.pending[level] = None
+                        self._emit(level + 1, merged)
+
+        def add(self, timestamp, value):
+                if self.current is None:
+                        self.current = _Bucket(timestamp, value)
+                else:
+                        self.current.add(timestamp, value)
+
+                if self.current.count == self.base_size:
+                        bucket = self.current
+                        self.current = None
+                        self._emit(0, bucket)
+
+                        now = time.monotonic()
+                        if now - self.last_flush >= self.flush_interval:
+                                self.flush()
+                                self.last_flush = now
+
+        def flush(self):
+                for f in self.files:
+                        f.flush()
+
+        def close(self):
+                # write the partial buckets at the tail of every level, up to a
+                # single bucket covering the whole capture
+                carry = self.current
+                self.current = None
+                level = 0
+                while carry is not None or level < len(self.files):
+                        if carry is not None:
+                                self._write(level, carry)
+                        else:
+                                self._level(level)
+
+                        pending = self.pending[level]
+                        self.pending[level] = None
+                        if pending is not None and carry is not None:
+                                carry = pending.merge(carry)
+                        elif pending is not None:
+                                carry = pending
+
+                        if self.n_written[level] <= 1:
+                                break
+                        level += 1
+
+                for f in self.files:
+                        f.close()
+
+
+class LodPyramidReader:
+
+        def __init__(self, lod_dir):
+                self.lod_dir = lod_dir
+                self.files = []
+                self._open_levels()
+                if not self.files:
+                        raise ValueError(f"no pyramid levels in {lod_dir}")
+
+        def _open_levels(self):
+                # pick up levels the writer has added since the last query
+                while os.path.exists(level_file_name(self.lod_dir, len(self.files))):
+                        f = open(level_file_name(self.lod_dir, len(self.files)), 'rb')
+                        header = f.read(LEVEL_HEADER.size)
+                        if len(header) < LEVEL_HEADER.size:
+                                f.close()
+                                break
+                        magic, level, base_shift = LEVEL_HEADER.unpack(header)
+                        if magic != LOD_MAGIC:
+                                raise ValueError(f"{f.name} is not a pyramid level")
+                        self.base_shift = base_shift
+                        self.files.append(f)
+
+        def n_buckets(self, level):
+                size = os.fstat(self.files[level].fileno()).st_size
+                return (size - LEVEL_HEADER.size) // BUCKET.size
+
+        def bucket(self, level, i):
+                f = self.files[level]
+                f.seek(LEVEL_HEADER.size + i * BUCKET.size)
+                return BUCKET.unpack(f.read(BUCKET.size))
+
+        def buckets(self, level, first, last):
+                f = self.files[level]
+                f.seek(LEVEL_HEADER.size + first * BUCKET.size)
+                data = f.read((last - first + 1) * BUCKET.size)
+                return list(BUCKET.iter_unpack(data))
+
+        def _search(self, t, use_last):
+                # first level-0 bucket whose t_last (or t_first) is >= t
+                lo = 0
+                hi = self.n_buckets(0)
+                while lo < hi:
+                        mid = (lo + hi) // 2
+                        b = self.bucket(0, mid)
+                        if (b[1] if use_last else b[0]) < t:
+                                lo = mid + 1
+                        else:
+                                hi = mid
+                return lo
+
+        def _tail(self, level, first, last):
+                # merge level-0 buckets [first, last] into one, using the
+                # largest complete buckets below the given level
+                merged = None
+                i = first
+                while i <= last:
+                        j = level - 1
+                        while j > 0 and (i % (1 << j) != 0
+                                         or i + (1 << j) - 1 > last
+                                         or (i >> j) >= self.n_buckets(j)):
+                                j -= 1
+                        b = self.bucket(j, i >> j)
+                        merged = b if merged is None else merge_buckets(merged, b)
+                        i += 1 << j
+                return merged
+
+        def query(self, t_start, t_end, max_points):
+                """Return at most max_points buckets covering [t_start, t_end],
+                each as (t_first, t_last, min, max, mean, count), from the
+                finest level that fits. While the capture is still being written,
+                the newest data not yet in that level is merged from the finer
+                levels into one final bucket."""
+                if max_points < 1:
+                        raise ValueError(f"max_points must be at least 1, not {max_points}")
+
+                self._open_levels()
+                first = self._search(t_start, True)
+                last = self._search(t_end + 1, False) - 1
+                if last < first:
+                        return []
+
+                # the coarsest level still needed: its complete buckets plus at
+                # most one merged bucket for the unfinished tail
+                level = 0
+                while True:
+                        covered = min(last >> level, self.n_buckets(level) - 1)
+                        n_points = max(covered - (first >> level) + 1, 0)
+                        if (covered + 1) << level <= last:
+                                n_points += 1
+                        if (n_points <= max_points
+                            or level + 1 >= len(self.files)
+                            or self.n_buckets(level + 1) == 0):
+                                break
+                        level += 1
+
+                result = []
+                if covered >= first >> level:
+                        result = self.buckets(level, first >> level, covered)
+                tail_first = max(first, (covered + 1) << level)
+                if tail_first <= last:
+                        result.append(self._tail(level, tail_first, last))
+
+                # only at the top level can this still be too many
+                while len(result) > max_points:
+                        result[-2:] = [merge_buckets(result[-2], result[-1])]
+                return result
+
+        def close(self):
+                for f in self.files:
+                        f.close()
+
+
+def plot_range(lod_dir, t_start, t_end, n_points):
+        import matplotlib.pyplot as plt
+
+        reader = LodPyramidReader(lod_dir)
+        buckets = reader.query(t_start, t_end, n_points)
+        reader.close()
+
+        t = [(b[0] + b[1]) / 2 for b in buckets]
+        plt.fill_between(t, [b[2] for b in buckets], [b[3] for b in buckets], color='lightblue', label='min/max')
+        plt.plot(t, [b[4] for b in buckets], color='blue', label='mean')
+
+        plt.legend()
+
+        plt.xlabel ('timestamp [us]')
+        plt.ylabel ('temperature [C]')
+
+        plt.show()
+
+
+if __name__ == '__main__':
+        lod_dir = sys.argv[1]
+        t_start = int(sys.argv[2])
+        t_end = int(sys.argv[3])
+        n_points = int(sys.argv[4]) if len(sys.argv) > 4 else 1000
+
+        plot_range(lod_dir, t_start, t_end, n_points)
@@ -0,0 +1,246 @@
+#!/usr/bin/python3
+
+# Shared-memory ring for fanning out decoded samples from one capture to any
+# number of live readers (plotting, archiving, alarms, ...).
+#
+# One writer publishes blocks of (timestamp, adc) samples into a POSIX
+# shared-memory segment. Readers attach and detach at any time, never block
+# the writer, and read the blocks in place. A reader that falls more than a
+# ring's worth of blocks behind skips ahead and counts the lost blocks as
+# overruns. When the writer closes the ring it sets the closed flag, so readers
+# know to detach (and re-attach by name to follow the next capture). The
+# writer's pid is kept too, so a writer that died without closing the ring
+# is treated as closed by readers on the same machine.
+#
+# Layout (all little-endian uint64 unless noted):
+#   header: magic, n_slots, block_samples, write_seq, closed, writer pid
+#   slot:   seq, n_samples, timestamps[block_samples],
+#           adc[block_samples] (uint16, padded to 8 bytes)
+#
+# A slot's seq is 2*s+1 while block s is being written and 2*s+2 once it is
+# complete, so a reader can tell whether the block it looked at was
+# overwritten underneath it.
+
+import os
+import sys
+import time
+from multiprocessing import shared_memory
+
+RING_MAGIC = 0x474e495253434950  # 'PICSRING'
+HEADER_WORDS = 6
+
+
+class RingClosed(Exception):
+        pass
+
+
+def writer_alive(pid):
+        try:
+                os.kill(pid, 0)
+        except ProcessLookupError:
+                return False
+        except PermissionError:
+                pass
+        return True
+
+
+def slot_words(block_samples):
+        adc_words = (2 * block_samples + 7) // 8
+        return 2 + block_samples + adc_words
+
+
+class SampleRingWriter:
+
+        def __init__(self, name, n_slots=64, block_samples=1024):
+                self.n_slots = n_slots
+                self.block_samples = block_samples
+                self.slot_words = slot_words(block_samples)
+
+                size = 8 * (HEADER_WORDS + n_slots * self.slot_words)
+                try:
+                        self.shm = shared_memory.SharedMemory(name=name, create=True, size=size)
+                except FileExistsError:
+                        # left behind by a writer that did not close; retire it so
+                        # its readers detach, then start afresh
+                        stale = shared_memory.SharedMemory(name=name)
+                        if stale.size >= 8 * HEADER_WORDS:
+                                stale_words = stale.buf.cast('Q')
+                                if stale_words[0] == RING_MAGIC:
+                                        stale_words[4] = 1
+                                stale_words.release()
+                        stale.close()
+                        stale.unlink()
+                        self.shm = shared_memory.SharedMemory(name=name, create=True, size=size)
+                self.words = self.shm.buf.cast('Q')
+                self.halfwords = self.shm.buf.cast('H')
+
+                self.words[1] = n_slots
+                self.words[2] = block_samples
+                self.words[3] = 0
+                self.words[4] = 0
+                self.words[5] = os.getpid()
+                self.words[0] = RING_MAGIC
+
+                self.seq = 0
+
+        def publish(self, timestamps, adcs):
+                n = len(timestamps)
+                if n > self.block_samples:
+                        raise ValueError(f"block of {n} samples exceeds {self.block_samples}")
+
+                s = self.seq
+                base = HEADER_WORDS + (s % self.n_slots) * self.slot_words
+
+                self.words[base] = 2 * s + 1
+                self.words[base + 1] = n
+                self.words[base + 2:base + 2 + n] = memoryview_of(timestamps, 'Q')
+                adc_base = 4 * (base + 2 + self.block_samples)
+                self.halfwords[adc_base:adc_base + n] = memoryview_of(adcs, 'H')
+                self.words[base] = 2 * s + 2
+
+                self.seq = s + 1
+                self.words[3] = self.seq
+
+        def close(self):
+                self.words[4] = 1
+                self.words.release()
+                self.halfwords.release()
+                self.shm.close()
+                self.shm.unlink()
+
+
+class SampleRingReader:
+
+        def __init__(self, name):
+                # keep the segment out of Python's resource tracker, which would
+                # otherwise unlink it when this reader exits; only the writer
+                # owns it
+                from multiprocessing import resource_tracker
+                register = resource_tracker.register
+                resource_tracker.register = lambda name, rtype: None
+                try:
+                        self.shm = shared_memory.SharedMemory(name=name)
+                finally:
+                        resource_tracker.register = register
+
+                if self.shm.size < 8 * HEADER_WORDS:
+                        self.shm.close()
+                        raise ValueError(f"{name} is not a sample ring")
+                self.words = self.shm.buf.cast('Q')
+                self.halfwords = self.shm.buf.cast('H')
+                # also the case while a new writer is still setting the ring up
+                if self.words[0] != RING_MAGIC:
+                        self.close()
+                        raise ValueError(f"{name} is not a sample ring")
+                if self._writer_done():
+                        self.close()
+                        raise RingClosed()
+
+                self.n_slots = self.words[1]
+                self.block_samples = self.words[2]
+                self.slot_words = slot_words(self.block_samples)
+
+                # start with the next block the writer publishes
+                self.seq = self.words[3]
+                self.overruns = 0
+                self.current = None
+
+        def read_block(self):
+                """Return (timestamps, adcs) views of the next block, or None if
+                there is no new block yet. The views point into the ring; call
+                still_valid() after using them to check they were not
+                overwritten in the meantime. Raises RingClosed once the writer
+                has closed the ring (or died) and every block has been read."""
+                write_seq = self.words[3]
+                if self.seq >= write_seq:
+                        if not self._writer_done():
+                                return None
+                        # the writer is finished, so write_seq is now final
+                        write_seq = self.words[3]
+                        if self.seq >= write_seq:
+                                raise RingClosed()
+
+                if write_seq - self.seq > self.n_slots - 1:
+                        # lapped by the writer: skip to the oldest safe block
+                        skipped = write_seq - (self.n_slots - 1) - self.seq
+                        self.overruns += skipped
+                        self.seq += skipped
+
+                s = self.seq
+                base = HEADER_WORDS + (s % self.n_slots) * self.slot_words
+                self.seq = s + 1
+
+                if self.words[base] != 2 * s + 2:
+                        self.overruns += 1
+                        return None
+
+                n = self.words[base + 1]
+                adc_base = 4 * (base + 2 + self.block_samples)
+                self.current = (base, 2 * s + 2)
+                return (self.words[base + 2:base + 2 + n],
+                        self.halfwords[adc_base:adc_base + n])
+
+        def _writer_done(self):
+                return self.words[4] != 0 or not writer_alive(self.words[5])
+
+        def still_valid(self):
+                """True if the last block returned by read_block() is intact."""
+                base, tag = self.current
+                if self.words[base] == tag:
+                        return True
+                self.overruns += 1
+                return False
+
+        def close(self):
+                self.words.release()
+                self.halfwords.release()
+                self.shm.close()
+
+
+def memoryview_of(values, fmt):
+        if isinstance(values, memoryview) and values.format == fmt:
+                return values
+        import array
+        return memoryview(array.array(fmt, values))
+
+
+def follow(name):
+        # simple reader: print each block as it arrives, and wait for the
+        # next capture when the writer closes the ring
+        reader = None
+        try:
+                while True:
+                        if reader is None:
+                                try:
+                                        reader = SampleRingReader(name)
+                                        print(f"attached to {name}")
+                                except (FileNotFoundError, ValueError, RingClosed):
+                                        # not created yet, still being set up, or
+                                        # left behind by a finished writer
+                                        time.sleep(0.5)
+                                        continue
+
+                        try:
+                                block = reader.read_block()
+                        except RingClosed:
+                                print(f"{name} closed, overruns {reader.overruns}")
+                                reader.close()
+                                reader = None
+                                continue
+
+                        if block is None:
+                                time.sleep(0.01)
+                                continue
+                        timestamps, adcs = block
+                        if len(timestamps):
+                                print(f"{reader.seq - 1}: {len(timestamps)} samples, "
+                                      f"first {timestamps[0]},{adcs[0]}, overruns {reader.overruns}")
+                        del timestamps, adcs, block
+        except KeyboardInterrupt:
+                pass
+        if reader is not None:
+                reader.close()
+
+
+if __name__ == '__main__':
+        follow(sys.argv[1])
@@ -0,0 +1,81 @@
+#!/usr/bin/python3
+
+# Benchmark the shared-memory sample ring with 1-8 concurrent readers.
+#
+#   pico_ring_bench.py [n_blocks] [block_samples]
+#
+# For each reader count, the writer publishes n_blocks blocks as fast as it
+# can; every reader sums the adc values of each block it sees. Reports the
+# writer's time per block and each reader's time per block and overruns.
+
+import multiprocessing
+import os
+import sys
+import time
+
+from pico_ring import SampleRingWriter, SampleRingReader
+
+
+def reader_process(name, n_blocks, ready, results):
+        reader = SampleRingReader(name)
+        ready.release()
+
+        n_read = 0
+        busy_ns = 0
+        checksum = 0
+        while reader.seq < n_blocks:
+                t_start = time.perf_counter_ns()
+                block = reader.read_block()
+                if block is None:
+                        # nothing new yet, let the writer run
+                        time.sleep(0)
+                        continue
+                timestamps, adcs = block
+                checksum += sum(adcs)
+                if reader.still_valid():
+                        n_read += 1
+                del timestamps, adcs, block
+                busy_ns += time.perf_counter_ns() - t_start
+
+        results.put((os.getpid(), n_read, busy_ns, reader.overruns))
+        reader.close()
+
+
+def run(n_readers, n_blocks, block_samples):
+        name = f"pico_ring_bench_{os.getpid()}"
+        writer = SampleRingWriter(name, block_samples=block_samples)
+
+        ready = multiprocessing.Semaphore(0)
+        results = multiprocessing.Queue()
+        readers = [multiprocessing.Process(target=reader_process, args=(name, n_blocks, ready, results))
+                   for i in range(n_readers)]
+        for p in readers:
+                p.start()
+        for p in readers:
+                ready.acquire()
+
+        timestamps = list(range(block_samples))
+        adcs = [i % 4096 for i in range(block_samples)]
+
+        t_start = time.perf_counter_ns()
+        for b in range(n_blocks):
+                writer.publish(timestamps, adcs)
+        write_ns = time.perf_counter_ns() - t_start
+
+        reader_results = [results.get() for p in readers]
+        for p in readers:
+                p.join()
+        writer.close()
+
+        print(f"{n_readers} readers: write {write_ns / n_blocks / 1e3:.2f} us/block")
+        for pid, n_read, busy_ns, overruns in reader_results:
+                per_block = busy_ns / max(n_read, 1) / 1e3
+                print(f"    reader {pid}: read {n_read} blocks, {per_block:.2f} us/block, overruns {overruns}")
+
+
+if __name__ == '__main__':
+        n_blocks = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+        block_samples = int(sys.argv[2]) if len(sys.argv) > 2 else 1024
+
+        for n_readers in range(1, 9):
+                run(n_readers, n_blocks, block_samples)
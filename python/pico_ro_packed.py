@@ -5,6 +5,10 @@ import struct
 import numpy
 import h5py
 import sys
+import time
+
+from pico_lod import LodPyramidWriter
+from pico_ring import SampleRingWriter
 
 def convert_adc_to_temperature(adc_value):
     # 12-bit conversion, assume max value == ADC_VREF == 3.3 V
@@ -15,9 +19,12 @@ def convert_adc_to_temperature(adc_value):
     return tempC
 
 
-def temperature_readout(mode):
+# longest a live ring reader waits for a partly filled block
+RING_PUBLISH_INTERVAL = 0.1
+
+
+def temperature_readout(mode, device_name='/dev/tty.usbmodem11101', ring_name=None):
 
-        device_name='/dev/tty.usbmodem11101'
         serial_device = serial.Serial(device_name)  # open serial port
 
         n=0
@@ -25,89 +32,131 @@ def temperature_readout(mode):
         # csv
         f_csv = open(f"temp_data_{mode}.csv", "w")
 
-        serial_device.write(b'\r')
+        # min/max pyramid for plotting long captures
+        lod = LodPyramidWriter(f"temp_data_{mode}.lod")
 
-        line = serial_device.readline()
-        text = line.decode()
-        words=text.split()
-        target=int(words[5])
-        print(f"target is {target}")
+        # shared-memory ring for live readers
+        ring = None
+        if ring_name:
+                ring = SampleRingWriter(ring_name)
+                block_ts = []
+                block_adc = []
+                last_publish = time.monotonic()
 
-        if mode == 'packed':
-                pack_size=int(words[9])        
-                print(f"pack size: {pack_size}")
-                debug=int(words[11])
-                print(f"debug: {debug}")
+        try:
+                serial_device.write(b'\r')
 
-        first_ts=0
-        first_adc=0
+                line = serial_device.readline()
+                text = line.decode()
+                words=text.split()
+                target=int(words[5])
+                print(f"target is {target}")
 
-        last_ts=0
-        last_adc=0
-        while n<target:
                 if mode == 'packed':
-                        if n==0:
+                        pack_size=int(words[9])        
+                        print(f"pack size: {pack_size}")
+                        debug=int(words[11])
+                        print(f"debug: {debug}")
+
+                first_ts=0
+                first_adc=0
+
+                last_ts=0
+                last_adc=0
+                while n<target:
+                        if mode == 'packed':
+                                if n==0:
+                                        ts_bytes = serial_device.read(8)
+                                        adc_bytes = serial_device.read(2)
+
+                                        # extract data
+                                        timestamp = int.from_bytes(ts_bytes, "little")
+                                        adc = int.from_bytes(adc_bytes, "little")
+
+                                        first_ts=timestamp
+                                        first_adc=adc
+                                else:
+                                        if pack_size == 2:
+
+                                                ts_diff_data_bytes=serial_device.read(1)
+                                                adc_diff_data_bytes=serial_device.read(1)
+                                
+                                                timestamp_diff=int.from_bytes(ts_diff_data_bytes, "little")
+                                                adc_diff=int.from_bytes(adc_diff_data_bytes, "little", signed="True")
+                                        elif pack_size == 1:
+                                                data_bytes=serial_device.read(1)
+                                                byte = int.from_bytes(data_bytes, "little")
+                                                timestamp_diff=byte&0x7
+                                                adc_diff=(byte>>3)&0xf
+                                                adc_sign=(byte>>7)
+                                                if adc_sign==0:
+                                                        adc_diff=-adc_diff
+
+                                        timestamp=last_ts+timestamp_diff
+                                        adc=last_adc+adc_diff
+                                
+                                        if debug:
+                                                diff_line = serial_device.readline()
+                                                diff_text = diff_line.decode()
+                                                print(f"calc:{timestamp_diff},{adc_diff}")
+                                                print(diff_text)
+
+                                last_ts=timestamp
+                                last_adc=adc
+                        elif mode == 'binary':        
                                 ts_bytes = serial_device.read(8)
                                 adc_bytes = serial_device.read(2)
 
                                 # extract data
                                 timestamp = int.from_bytes(ts_bytes, "little")
                                 adc = int.from_bytes(adc_bytes, "little")
-
-                                first_ts=timestamp
-                                first_adc=adc
-                        else:
-                                if pack_size == 2:
-
-                                        ts_diff_data_bytes=serial_device.read(1)
-                                        adc_diff_data_bytes=serial_device.read(1)
-                                
-                                        timestamp_diff=int.from_bytes(ts_diff_data_bytes, "little")
-                                        adc_diff=int.from_bytes(adc_diff_data_bytes, "little", signed="True")
-                                elif pack_size == 1:
-                                        data_bytes=serial_device.read(1)
-                                        byte = int.from_bytes(data_bytes, "little")
-                                        timestamp_diff=byte&0x7
-                                        adc_diff=(byte>>3)&0xf
-                                        adc_sign=(byte>>7)
-                                        if adc_sign==0:
-                                                adc_diff=-adc_diff
-
-                                timestamp=last_ts+timestamp_diff
-                                adc=last_adc+adc_diff
-                                
-                                if debug:
-                                        diff_line = serial_device.readline()
-                                        diff_text = diff_line.decode()
-                                        print(f"calc:{timestamp_diff},{adc_diff}")
-                                        print(diff_text)
-
-                        last_ts=timestamp
-                        last_adc=adc
-                elif mode == 'binary':        
-                        ts_bytes = serial_device.read(8)
-                        adc_bytes = serial_device.read(2)
-
-                        # extract data
-                        timestamp = int.from_bytes(ts_bytes, "little")
-                        adc = int.from_bytes(adc_bytes, "little")
                 
-                temperature = convert_adc_to_temperature(adc)
-                print(f"{n}: {timestamp},{adc},{temperature}")
-                # csv
-                f_csv.write(f"{timestamp},{adc},{temperature}")
-
-                n+=1
-
-        lines=0
-        while(lines<3):
-                benchmark_line = serial_device.readline()
-                benchmark_text = benchmark_line.decode()
-                print(benchmark_text)
-                lines+=1
-
-        f_csv.close()
+                        temperature = convert_adc_to_temperature(adc)
+                        print(f"{n}: {timestamp},{adc},{temperature}")
+                        # csv
+                        f_csv.write(f"{timestamp},{adc},{temperature}")
+                        lod.add(timestamp, temperature)
+
+                        if ring:
+                                # a lossy or corrupted stream can decode to values
+                                # outside the ring's uint64/uint16 fields
+                                block_ts.append(timestamp & 0xffffffffffffffff)
+                                block_adc.append(min(max(adc, 0), 0xffff))
+                                now = time.monotonic()
+                                if (len(block_ts) == ring.block_samples
+                                    or now - last_publish >= RING_PUBLISH_INTERVAL):
+                                        ring.publish(block_ts, block_adc)
+                                        block_ts = []
+                                        block_adc = []
+                                        last_publish = now
+
+                        n+=1
+
+                lines=0
+                while(lines<3):
+                        benchmark_line = serial_device.readline()
+                        benchmark_text = benchmark_line.decode()
+                        print(benchmark_text)
+                        lines+=1
+        finally:
+                # also on a hangup or a corrupted line, so live readers see the
+                # ring close and the pyramid gets its top levels
+                if ring:
+                        try:
+                                if block_ts:
+                                        ring.publish(block_ts, block_adc)
+                        finally:
+                                ring.close()
+                f_csv.close()
+                lod.close()
 
 if __name__ == '__main__':
         mode = sys.argv[1]
-        temperature_readout(mode)
\ No newline at end of file
+        if len(sys.argv) > 3:
+                # publish the decoded samples to the named shared-memory ring
+                temperature_readout(mode, sys.argv[2], sys.argv[3])
+        elif len(sys.argv) > 2:
+                # e.g. a pty from pico_stream.py replay
+                temperature_readout(mode, sys.argv[2])
+        else:
+                temperature_readout(mode)
\ No newline at end of file
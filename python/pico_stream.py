@@ -0,0 +1,220 @@
+#!/usr/bin/python3
+
+# Record the raw byte stream from a Pico DAQ board to a file, and replay it
+# into a pty so the host-side readout can be run without hardware.
+#
+#   pico_stream.py record <device> <output file>
+#   pico_stream.py replay <input file> [--fast] [--drop P] [--corrupt P]
+#                         [--stall P] [--stall-ms MS] [--seed S] [--linger SEC]
+#
+# The replay prints the pty path, which can be given to pico_ro_packed.py in
+# place of the board's device path.
+
+import argparse
+import fcntl
+import os
+import random
+import struct
+import sys
+import termios
+import time
+import tty
+
+# file layout: magic, version, then one chunk header + payload per read
+STREAM_MAGIC = b'PICOSTRM'
+STREAM_VERSION = 1
+CHUNK_HEADER = struct.Struct('<cQI')
+
+# chunk kinds
+CHUNK_BANNER = b'B'
+CHUNK_DATA = b'D'
+CHUNK_TRAILER = b'T'
+
+N_TRAILER_LINES = 3
+
+
+def write_chunk(f, kind, t_ns, payload):
+        f.write(CHUNK_HEADER.pack(kind, t_ns, len(payload)))
+        f.write(payload)
+
+
+def read_chunks(file_name):
+        chunks = []
+        with open(file_name, 'rb') as f:
+                header = f.read(len(STREAM_MAGIC) + 2)
+                if header[:len(STREAM_MAGIC)] != STREAM_MAGIC:
+                        raise ValueError(f"{file_name} is not a recorded stream")
+                version = struct.unpack('<H', header[len(STREAM_MAGIC):])[0]
+                if version != STREAM_VERSION:
+                        raise ValueError(f"unsupported stream version {version}")
+
+                while True:
+                        chunk_header = f.read(CHUNK_HEADER.size)
+                        if len(chunk_header) < CHUNK_HEADER.size:
+                                break
+                        kind, t_ns, length = CHUNK_HEADER.unpack(chunk_header)
+                        payload = f.read(length)
+                        if len(payload) < length:
+                                break
+                        chunks.append((kind, t_ns, payload))
+        return chunks
+
+
+def parse_banner(text):
+        # "Hello, multicore! I will send <n> samples! [Pack size: <p> Debug: <d>]"
+        words = text.split()
+        target = int(words[5])
+        if len(words) > 11:
+                return 'packed', target, int(words[9]), int(words[11])
+        return 'binary', target, 0, 0
+
+
+def record(device_name, out_name):
+        import serial
+
+        serial_device = serial.Serial(device_name)  # open serial port
+
+        with open(out_name, 'wb') as f:
+                f.write(STREAM_MAGIC)
+                f.write(struct.pack('<H', STREAM_VERSION))
+
+                serial_device.write(b'\r')
+                t0 = time.monotonic_ns()
+
+                banner = serial_device.readline()
+                write_chunk(f, CHUNK_BANNER, time.monotonic_ns() - t0, banner)
+
+                mode, target, pack_size, debug = parse_banner(banner.decode())
+                print(f"mode: {mode} target: {target} pack size: {pack_size} debug: {debug}")
+
+                if debug:
+                        # one chunk per sample: packed bytes plus the debug line
+                        first = serial_device.read(10)
+                        write_chunk(f, CHUNK_DATA, time.monotonic_ns() - t0, first)
+                        for n in range(1, target):
+                                data = serial_device.read(pack_size)
+                                data += serial_device.readline()
+                                write_chunk(f, CHUNK_DATA, time.monotonic_ns() - t0, data)
+                else:
+                        # record reads as they arrive to keep the link timing
+                        if mode == 'packed':
+                                remaining = 10 + (target - 1) * pack_size
+                        else:
+                                remaining = 10 * target
+                        while remaining > 0:
+                                n_bytes = min(max(serial_device.in_waiting, 1), remaining)
+                                data = serial_device.read(n_bytes)
+                                write_chunk(f, CHUNK_DATA, time.monotonic_ns() - t0, data)
+                                remaining -= len(data)
+
+                for line in range(N_TRAILER_LINES):
+                        trailer = serial_device.readline()
+                        write_chunk(f, CHUNK_TRAILER, time.monotonic_ns() - t0, trailer)
+                        print(trailer.decode(), end='')
+
+        serial_device.close()
+
+
+def inject_faults(payload, rng, drop, corrupt):
+        if drop == 0 and corrupt == 0:
+                return payload
+
+        out = bytearray()
+        for byte in payload:
+                r = rng.random()
+                if r < drop:
+                        continue
+                if r < drop + corrupt:
+                        byte ^= rng.randint(1, 255)
+                out.append(byte)
+        return bytes(out)
+
+
+def replay(in_name, fast, drop, corrupt, stall, stall_ms, seed, linger):
+        chunks = read_chunks(in_name)
+        rng = random.Random(seed)
+
+        master, slave = os.openpty()
+        tty.setraw(slave)
+        slave_name = os.ttyname(slave)
+        print(slave_name, flush=True)
+
+        # like the firmware, wait for the consumer to send 'enter'
+        while os.read(master, 1) != b'\r':
+                pass
+        # the consumer holds its own handle now, so EIO on master means it closed
+        os.close(slave)
+
+        n_bytes = 0
+        t0 = time.monotonic_ns()
+        for kind, t_ns, payload in chunks:
+                if not fast:
+                        delay = (t0 + t_ns - time.monotonic_ns()) / 1e9
+                        if delay > 0:
+                                time.sleep(delay)
+
+                if kind == CHUNK_DATA:
+                        if stall and rng.random() < stall:
+                                time.sleep(stall_ms / 1e3)
+                        payload = inject_faults(payload, rng, drop, corrupt)
+
+                try:
+                        os.write(master, payload)
+                except OSError:
+                        print("consumer closed the pty", file=sys.stderr)
+                        break
+                n_bytes += len(payload)
+
+        t_replay = (time.monotonic_ns() - t0) / 1e9
+        print(f"replayed {len(chunks)} chunks, {n_bytes} bytes in {t_replay:.3f} s", file=sys.stderr)
+
+        # keep the pty alive while the consumer is still draining it, and close
+        # once the unread byte count has not fallen for linger seconds (all
+        # read, consumer gone, or blocked on bytes lost to --drop); closing the
+        # master then gives the consumer a hangup instead of a hang
+        try:
+                probe = os.open(slave_name, os.O_RDWR | os.O_NOCTTY)
+        except OSError:
+                probe = None
+        if probe is not None:
+                unread = unread_bytes(probe)
+                t_progress = time.monotonic()
+                while time.monotonic() - t_progress < linger:
+                        time.sleep(min(0.05, linger))
+                        now_unread = unread_bytes(probe)
+                        if now_unread < unread:
+                                t_progress = time.monotonic()
+                        unread = now_unread
+                os.close(probe)
+        os.close(master)
+
+
+def unread_bytes(fd):
+        buf = fcntl.ioctl(fd, termios.FIONREAD, b'\0\0\0\0')
+        return struct.unpack('i', buf)[0]
+
+
+if __name__ == '__main__':
+        parser = argparse.ArgumentParser(description='record or replay a raw Pico DAQ stream')
+        commands = parser.add_subparsers(dest='command', required=True)
+
+        record_parser = commands.add_parser('record')
+        record_parser.add_argument('device')
+        record_parser.add_argument('output')
+
+        replay_parser = commands.add_parser('replay')
+        replay_parser.add_argument('input')
+        replay_parser.add_argument('--fast', action='store_true', help='ignore recorded timing')
+        replay_parser.add_argument('--drop', type=float, default=0.0, help='per-byte loss probability')
+        replay_parser.add_argument('--corrupt', type=float, default=0.0, help='per-byte corruption probability')
+        replay_parser.add_argument('--stall', type=float, default=0.0, help='per-chunk stall probability')
+        replay_parser.add_argument('--stall-ms', type=float, default=50.0)
+        replay_parser.add_argument('--seed', type=int, default=0)
+        replay_parser.add_argument('--linger', type=float, default=2.0,
+                                   help='seconds to wait for an idle consumer after the last byte')
+
+        args = parser.parse_args()
+        if args.command == 'record':
+                record(args.device, args.output)
+        else:
+                replay(args.input, args.fast, args.drop, args.corrupt, args.stall, args.stall_ms, args.seed, args.linger)